@@ -5,21 +5,63 @@
 #include <cstddef>
 #include <algorithm>
 #include <iterator>
+#include <utility>
+#include <vector>
+#if __GXX_EXPERIMENTAL_CXX0X__
+#include <chrono>
+#include <future>
+#include <type_traits>
+#endif
 
 namespace inplace_radixxx {
 
+// Customization point for key types the engine does not know natively.
+// A specialization maps a key to an unsigned integer whose natural order
+// matches the order of the keys:
+//
+//     template <>
+//     struct key_traits<my_key> {
+//         typedef unsigned long radix_type;
+//         static std::size_t const bits = 40; // significant low bits of radix_type
+//         static radix_type to_radix(my_key const& k);
+//     };
+//
+// Keys with a specialization are sorted by radix passes over the low `bits`
+// bits of to_radix(k) instead of falling back to std::sort.
+template <typename T, typename Enable = void>
+struct key_traits {};
+
 namespace detail {
 
 struct unsigned_tag {};
 struct signed_tag {};
 struct bool_tag {};
+struct traits_tag {};
 struct others_tag {};
 
+typedef char no_type;
+struct yes_type { char x[2]; };
+
+template <typename>
+no_type has_radix_type(...);
 template <typename T>
-struct get_tag {
+yes_type has_radix_type(typename T::radix_type*);
+
+template <bool HasKeyTraits>
+struct get_tag_impl {
     typedef others_tag type;
 };
 
+template <>
+struct get_tag_impl<true> {
+    typedef traits_tag type;
+};
+
+template <typename T>
+struct get_tag
+    : get_tag_impl<sizeof(has_radix_type<key_traits<T> >(0)) == sizeof(yes_type)>
+{};
+
 #define INPLACE_RADIXXX_SPECIALIZE_GET_TAG(type_, tag_) \
 template <> \
 struct get_tag<type_> { \
@@ -63,23 +105,47 @@ INPLACE_RADIXXX_SPECIALIZE_MAKE_UNSIGNED(long, unsigned long);
 std::size_t const nbits = 8;
 std::size_t const nbuckets = 1 << nbits;
 
-template <typename Int>
+template <typename Int, typename Tag>
 struct initial_shift {
     static std::size_t const value = sizeof(Int) * CHAR_BIT - nbits;
 };
 
+// Digits are aligned to multiples of nbits, so a key with `bits` significant
+// bits takes ceil(bits / nbits) passes.
+template <typename Key>
+struct initial_shift<Key, traits_tag> {
+    // key_traits<Key>::bits must be within 1 and the width of radix_type.
+    typedef char bits_out_of_range[
+        0 < key_traits<Key>::bits
+        && key_traits<Key>::bits <= sizeof(typename key_traits<Key>::radix_type) * CHAR_BIT
+        ? 1 : -1];
+
+    static std::size_t const value =
+        (key_traits<Key>::bits + nbits - 1) / nbits * nbits - nbits;
+};
+
 template <typename Int, typename Tag>
 struct initial_mask {
-    static Int const value = (nbuckets - 1) << initial_shift<Int>::value;
+    typedef Int type;
+    static Int const value = (nbuckets - 1) << initial_shift<Int, Tag>::value;
+};
+
+template <typename Key>
+struct initial_mask<Key, traits_tag> {
+    typedef typename key_traits<Key>::radix_type type;
+    static type const value =
+        type(nbuckets - 1) << initial_shift<Key, traits_tag>::value;
 };
 
 template <typename Int>
 struct initial_mask<Int, bool_tag> {
+    typedef bool type;
     static bool const value = false;
 };
 
 template <typename Int>
 struct initial_mask<Int, others_tag> {
+    typedef int type;
     static int const value = 0;
 };
 
@@ -148,9 +214,6 @@ struct result_of_impl<true, Functor, Argument>
     : remove_ref_and_cv<typename Functor::result_type>
 {};
 
-typedef char no_type;
-struct yes_type { char x[2]; };
-
 template <typename>
 no_type has_result_type(...);
 template <typename T>
@@ -205,43 +268,90 @@ private:
     Functor get_key_;
 };
 
-template <typename Iterator, typename T, typename Functor>
-void sort_impl(Iterator first, Iterator last, T mask, std::size_t shift,
-               Functor const& get_key, unsigned_tag tag)
-{
-    typedef typename std::iterator_traits<Iterator>::difference_type diff_t;
-    if (std::distance(first, last) <= diff_t(4 * nbuckets)) {
-        compare_key<Functor> cmp(get_key);
-        std::sort(first, last, cmp);
-        return;
+// Permutes [first, last) into n buckets by bucket_of(element), which must
+// be less than n; upper_bounds[i] receives the end of bucket i.  count_ and
+// its are scratch arrays of n elements, count_ zero-initialized.  Elements
+// are exchanged through swap(x, y), std::iter_swap by default.
+struct iter_swapper {
+    template <typename Iterator>
+    void operator()(Iterator x, Iterator y) const {
+        std::iter_swap(x, y);
     }
+};
 
-    typedef typename std::iterator_traits<Iterator>::value_type value_t;
-    typedef typename detail::result_of<Functor (value_t)>::type key_t;
-
-    std::size_t count_[nbuckets] = {};
-    for (Iterator it = first; it != last; ++it) {
-        T pos = (get_key(*it) & mask) >> shift;
-        ++count_[pos];
-    }
-    for (std::size_t i = 1; i < nbuckets; ++i)
+template <typename Iterator, typename Bucket, typename Swap>
+void permute_by(Iterator first, Iterator last, Bucket const& bucket_of, std::size_t n,
+                std::size_t* count_, Iterator* its, Iterator* upper_bounds, Swap const& swap)
+{
+    for (Iterator it = first; it != last; ++it)
+        ++count_[bucket_of(*it)];
+    for (std::size_t i = 1; i < n; ++i)
         count_[i] += count_[i-1];
-    Iterator upper_bounds[nbuckets];
-    for (std::size_t i = 0; i < nbuckets; ++i) {
+    for (std::size_t i = 0; i < n; ++i) {
         upper_bounds[i] = first;
         std::advance(upper_bounds[i], count_[i]);
     }
-    Iterator its[nbuckets];
     its[0] = first;
-    for (std::size_t i = 1; i < nbuckets; ++i)
+    for (std::size_t i = 1; i < n; ++i)
         its[i] = upper_bounds[i-1];
-    for (std::size_t i = 0; i < nbuckets; ++i) {
+    for (std::size_t i = 0; i < n; ++i) {
         while (its[i] != upper_bounds[i]) {
-            T const m = (get_key(*its[i]) & mask) >> shift;
-            std::iter_swap(its[i], its[m]);
+            std::size_t const m = bucket_of(*its[i]);
+            swap(its[i], its[m]);
             ++its[m];
         }
     }
+}
+
+template <typename Iterator, typename Bucket>
+inline void permute_by(Iterator first, Iterator last, Bucket const& bucket_of, std::size_t n,
+                       std::size_t* count_, Iterator* its, Iterator* upper_bounds)
+{
+    permute_by(first, last, bucket_of, n, count_, its, upper_bounds, iter_swapper());
+}
+
+template <typename Functor, typename T>
+struct radix_digit {
+    radix_digit(Functor const& get_key, T mask, std::size_t shift)
+        : get_key_(get_key), mask_(mask), shift_(shift)
+    {}
+
+    template <typename U>
+    std::size_t operator()(U const& x) const {
+        return (get_key_(x) & mask_) >> shift_;
+    }
+
+private:
+    Functor get_key_;
+    T mask_;
+    std::size_t shift_;
+};
+
+// Permutes [first, last) into nbuckets buckets by the digit selected by
+// mask and shift; upper_bounds[i] receives the end of bucket i.
+template <typename Iterator, typename T, typename Functor>
+inline void radix_partition(Iterator first, Iterator last, T mask, std::size_t shift,
+                            Functor const& get_key, Iterator* upper_bounds)
+{
+    std::size_t count_[nbuckets] = {};
+    Iterator its[nbuckets];
+    permute_by(first, last, radix_digit<Functor, T>(get_key, mask, shift), nbuckets,
+               count_, its, upper_bounds);
+}
+
+template <typename Iterator, typename T, typename Functor>
+void sort_impl(Iterator first, Iterator last, T mask, std::size_t shift,
+               Functor const& get_key, unsigned_tag tag)
+{
+    typedef typename std::iterator_traits<Iterator>::difference_type diff_t;
+    if (std::distance(first, last) <= diff_t(4 * nbuckets)) {
+        compare_key<Functor> cmp(get_key);
+        std::sort(first, last, cmp);
+        return;
+    }
+
+    Iterator upper_bounds[nbuckets];
+    radix_partition(first, last, mask, shift, get_key, upper_bounds);
     if (mask >>= nbits) {
         shift -= nbits;
         sort_impl(first, upper_bounds[0], mask, shift, get_key, tag);
@@ -289,152 +399,808 @@ inline void sort_impl(Iterator first, Iterator last, T, std::size_t, Functor con
     std::partition(first, last, key_not<Functor>(get_key));
 }
 
+template <typename Functor, typename Key>
+struct get_radix_key {
+    typedef typename key_traits<Key>::radix_type result_type;
+
+    explicit get_radix_key(Functor const& get_key) : get_key_(get_key) {}
+
+    template <typename T>
+    result_type operator()(T const& x) const {
+        return key_traits<Key>::to_radix(get_key_(x));
+    }
+
+private:
+    Functor get_key_;
+};
+
+template <typename Iterator, typename T, typename Functor>
+inline void sort_impl(Iterator first, Iterator last, T mask, std::size_t shift,
+                      Functor const& get_key, traits_tag)
+{
+    typedef typename std::iterator_traits<Iterator>::value_type value_t;
+    typedef typename detail::result_of<Functor (value_t)>::type key_t;
+    sort_impl(first, last, mask, shift,
+              get_radix_key<Functor, key_t>(get_key), unsigned_tag());
+}
+
 template <typename Iterator, typename T, typename Functor>
 inline void sort_impl(Iterator first, Iterator last, T, std::size_t, Functor const& get_key, others_tag)
 {
     std::sort(first, last, compare_key<Functor>(get_key));
 }
 
-template <typename T, typename R>
-class mem_fun_ptr_wrapper {
-    typedef R (T::*mem_fun_ptr)();
+// partition_top() does the first level of sort_impl() and appends the end
+// of every resulting bucket to `bounds`; sort_rest() then finishes a single
+// bucket.  Sorting every bucket in order yields the same result as sort_impl().
+template <typename Iterator, typename T, typename Functor>
+void partition_top(Iterator first, Iterator last, T mask, std::size_t shift,
+                   Functor const& get_key, std::vector<Iterator>& bounds, unsigned_tag)
+{
+    Iterator upper_bounds[nbuckets];
+    radix_partition(first, last, mask, shift, get_key, upper_bounds);
+    bounds.insert(bounds.end(), upper_bounds, upper_bounds + nbuckets);
+}
 
-public:
-    typedef R result_type;
+template <typename Iterator, typename T, typename Functor>
+inline void sort_rest(Iterator first, Iterator last, T mask, std::size_t shift,
+                      Functor const& get_key, unsigned_tag tag)
+{
+    if (mask >>= nbits)
+        sort_impl(first, last, mask, shift - nbits, get_key, tag);
+}
 
-    explicit mem_fun_ptr_wrapper(mem_fun_ptr p)
-        : p_(p)
-    {}
+template <typename Iterator, typename T, typename Functor>
+void partition_top(Iterator first, Iterator last, T mask, std::size_t shift,
+                   Functor const& get_key, std::vector<Iterator>& bounds, signed_tag)
+{
+    Iterator it = std::partition(first, last, key_is_negative<Functor>(get_key));
+    partition_top(first, it, mask, shift, get_key, bounds, unsigned_tag());
+    partition_top(it, last, mask, shift, get_key, bounds, unsigned_tag());
+}
 
-    result_type operator()(T& t) const {
-        return (t.*p_)();
-    }
-    result_type operator()(T* t) const {
-        return (t->*p_)();
-    }
+template <typename Iterator, typename T, typename Functor>
+inline void sort_rest(Iterator first, Iterator last, T mask, std::size_t shift,
+                      Functor const& get_key, signed_tag)
+{
+    sort_rest(first, last, mask, shift, get_key, unsigned_tag());
+}
 
-private:
-    mem_fun_ptr p_;
-};
+template <typename Iterator, typename T, typename Functor>
+inline void partition_top(Iterator first, Iterator last, T mask, std::size_t shift,
+                          Functor const& get_key, std::vector<Iterator>& bounds, bool_tag tag)
+{
+    sort_impl(first, last, mask, shift, get_key, tag);
+    bounds.push_back(last);
+}
 
-template <typename T, typename R>
-class mem_fun_const_ptr_wrapper {
-    typedef R (T::*mem_fun_ptr)() const;
+template <typename Iterator, typename T, typename Functor>
+inline void sort_rest(Iterator, Iterator, T, std::size_t, Functor const&, bool_tag) {}
 
-public:
-    typedef R result_type;
+template <typename Iterator, typename T, typename Functor>
+inline void partition_top(Iterator first, Iterator last, T mask, std::size_t shift,
+                          Functor const& get_key, std::vector<Iterator>& bounds, traits_tag)
+{
+    typedef typename std::iterator_traits<Iterator>::value_type value_t;
+    typedef typename detail::result_of<Functor (value_t)>::type key_t;
+    partition_top(first, last, mask, shift,
+                  get_radix_key<Functor, key_t>(get_key), bounds, unsigned_tag());
+}
 
-    explicit mem_fun_const_ptr_wrapper(mem_fun_ptr p)
-        : p_(p)
-    {}
+template <typename Iterator, typename T, typename Functor>
+inline void sort_rest(Iterator first, Iterator last, T mask, std::size_t shift,
+                      Functor const& get_key, traits_tag)
+{
+    typedef typename std::iterator_traits<Iterator>::value_type value_t;
+    typedef typename detail::result_of<Functor (value_t)>::type key_t;
+    sort_rest(first, last, mask, shift,
+              get_radix_key<Functor, key_t>(get_key), unsigned_tag());
+}
 
-    result_type operator()(T const& t) const {
-        return (t.*p_)();
-    }
-    result_type operator()(T const* t) const {
-        return (t->*p_)();
-    }
+template <typename Iterator, typename T, typename Functor>
+inline void partition_top(Iterator, Iterator last, T, std::size_t,
+                          Functor const&, std::vector<Iterator>& bounds, others_tag)
+{
+    bounds.push_back(last);
+}
 
-private:
-    mem_fun_ptr p_;
-};
+template <typename Iterator, typename T, typename Functor>
+inline void sort_rest(Iterator first, Iterator last, T mask, std::size_t shift,
+                      Functor const& get_key, others_tag tag)
+{
+    sort_impl(first, last, mask, shift, get_key, tag);
+}
 
-template <typename T, typename U>
-class mem_ptr_wrapper {
-public:
-    typedef U result_type;
+// index_impl() sorts like sort_impl() and records the bucket bounds of the
+// top `levels` digits in `bounds`; bucket_of() maps a key to its bucket.
+template <typename Iterator, typename T, typename Functor>
+void index_impl(Iterator first, Iterator last, T mask, std::size_t shift,
+                Functor const& get_key, std::size_t levels,
+                std::vector<Iterator>& bounds, unsigned_tag tag)
+{
+    Iterator upper_bounds[nbuckets];
+    radix_partition(first, last, mask, shift, get_key, upper_bounds);
+    for (std::size_t i = 0; i < nbuckets; ++i) {
+        if (levels > 1) {
+            index_impl(first, upper_bounds[i], T(mask >> nbits), shift - nbits, get_key,
+                       levels - 1, bounds, tag);
+        } else {
+            bounds.push_back(upper_bounds[i]);
+            sort_rest(first, upper_bounds[i], mask, shift, get_key, tag);
+        }
+        first = upper_bounds[i];
+    }
+}
 
-    explicit mem_ptr_wrapper(U T::* p)
-        : p_(p)
-    {}
+template <typename Key, typename T>
+inline std::size_t bucket_of(Key const& key, T mask, std::size_t shift, std::size_t, unsigned_tag)
+{
+    return (key & mask) >> shift;
+}
 
-    result_type operator()(T const& t) const {
-        return t.*p_;
-    }
-    result_type operator()(T const* t) const {
-        return t->*p_;
-    }
+template <typename Iterator, typename T, typename Functor>
+void index_impl(Iterator first, Iterator last, T mask, std::size_t shift,
+                Functor const& get_key, std::size_t levels,
+                std::vector<Iterator>& bounds, signed_tag)
+{
+    Iterator it = std::partition(first, last, key_is_negative<Functor>(get_key));
+    index_impl(first, it, mask, shift, get_key, levels, bounds, unsigned_tag());
+    index_impl(it, last, mask, shift, get_key, levels, bounds, unsigned_tag());
+}
 
-private:
-    U T::* p_;
-};
+template <typename Key, typename T>
+inline std::size_t bucket_of(Key const& key, T mask, std::size_t shift, std::size_t nbuckets_,
+                             signed_tag)
+{
+    return (key < 0 ? 0 : nbuckets_ / 2) + bucket_of(key, mask, shift, nbuckets_, unsigned_tag());
+}
 
-template <typename T>
-T& mem_fn_(T& t)
+template <typename Iterator, typename T, typename Functor>
+inline void index_impl(Iterator first, Iterator last, T mask, std::size_t shift,
+                       Functor const& get_key, std::size_t levels,
+                       std::vector<Iterator>& bounds, traits_tag)
 {
-    return t;
+    typedef typename std::iterator_traits<Iterator>::value_type value_t;
+    typedef typename detail::result_of<Functor (value_t)>::type key_t;
+    index_impl(first, last, mask, shift, get_radix_key<Functor, key_t>(get_key), levels,
+               bounds, unsigned_tag());
 }
 
-template <typename T>
-T const& mem_fn_(T const& t)
+template <typename Key, typename T>
+inline std::size_t bucket_of(Key const& key, T mask, std::size_t shift, std::size_t nbuckets_,
+                             traits_tag)
 {
-    return t;
+    return bucket_of(key_traits<Key>::to_radix(key), mask, shift, nbuckets_, unsigned_tag());
 }
 
-template <typename T, typename R>
-mem_fun_ptr_wrapper<T, R> mem_fn_(R (T::*p)())
+template <typename Iterator, typename T, typename Functor, typename Tag>
+inline void index_impl(Iterator first, Iterator last, T mask, std::size_t shift,
+                       Functor const& get_key, std::size_t,
+                       std::vector<Iterator>& bounds, Tag tag)
 {
-    return mem_fun_ptr_wrapper<T, R>(p);
+    sort_impl(first, last, mask, shift, get_key, tag);
+    bounds.push_back(last);
 }
 
-template <typename T, typename R>
-mem_fun_const_ptr_wrapper<T, R> mem_fn_(R (T::*p)() const)
+template <typename Key, typename T, typename Tag>
+inline std::size_t bucket_of(Key const&, T, std::size_t, std::size_t, Tag)
 {
-    return mem_fun_const_ptr_wrapper<T, R>(p);
+    return 0;
 }
 
-template <typename T, typename U>
-mem_ptr_wrapper<T, U> mem_fn_(U T::* p)
+// Directories cover at most this many digits, i.e. 65536 buckets; a third
+// digit would take 16M bucket bounds whatever the size of the range.
+std::size_t const max_levels = 2;
+
+// The number of buckets bucket_of() distinguishes when the digits indexed
+// by its mask and shift span n buckets.
+inline std::size_t directory_size(std::size_t n, unsigned_tag)
 {
-    return mem_ptr_wrapper<T, U>(p);
+    return n;
 }
-} // namespace detail
 
-template <typename Iterator, typename Functor>
-inline void sort(Iterator first, Iterator last, Functor get_key)
+inline std::size_t directory_size(std::size_t n, signed_tag)
 {
-    using detail::get_tag;
-    using detail::initial_mask;
-    using detail::initial_shift;
-    using detail::make_unsigned;
+    return 2 * n;
+}
 
-    typedef typename std::iterator_traits<Iterator>::value_type value_t;
-    typedef typename detail::result_of<Functor (value_t)>::type key_t;
-    typedef typename get_tag<key_t>::type tag;
+inline std::size_t directory_size(std::size_t n, traits_tag)
+{
+    return n;
+}
 
-    detail::sort_impl(first, last,
-                      initial_mask<typename make_unsigned<key_t>::type, tag>::value,
-                      initial_shift<key_t>::value,
-                      detail::mem_fn_(get_key),
-                      tag());
+template <typename Tag>
+inline std::size_t directory_size(std::size_t, Tag)
+{
+    return 1;
 }
 
-namespace detail {
-struct id {
-    template <typename T>
-    struct result;
+// Maps keys to unsigned integers of the same order with `digits` digits.
+// Keys without a radix mapping have no digits and all map to 0.
+template <typename Key, typename Tag>
+struct ordered_radix {
+    typedef unsigned char type;
+    static std::size_t const digits = 0;
 
-    template <typename Functor, typename T>
-    struct result<Functor (T)> {
-        typedef T type;
-    };
+    static type get(Key const&) {
+        return 0;
+    }
+};
 
-    template <typename T>
-    T const& operator()(T const& x) const {
-        return x;
-    };
+template <typename Key>
+struct ordered_radix<Key, unsigned_tag> {
+    typedef Key type;
+    static std::size_t const digits = sizeof(Key) * CHAR_BIT / nbits;
+
+    static type get(Key const& key) {
+        return key;
+    }
 };
-} // namespace detail
 
-template <typename Iterator>
-inline void sort(Iterator first, Iterator last)
+template <typename Key>
+struct ordered_radix<Key, signed_tag> {
+    typedef typename make_unsigned<Key>::type type;
+    static std::size_t const digits = sizeof(Key) * CHAR_BIT / nbits;
+
+    static type get(Key const& key) {
+        return type(key) ^ type(type(1) << (sizeof(Key) * CHAR_BIT - 1));
+    }
+};
+
+template <typename Key>
+struct ordered_radix<Key, traits_tag> {
+    typedef typename key_traits<Key>::radix_type type;
+    static std::size_t const digits = initial_shift<Key, traits_tag>::value / nbits + 1;
+
+    static type get(Key const& key) {
+        return key_traits<Key>::to_radix(key);
+    }
+};
+
+// Rewrites key functors of key_traits types to the radix keys they sort by,
+// so that code below only has to deal with natively ordered keys.
+template <typename Functor, typename Key, typename Tag>
+struct engine_key {
+    typedef Functor type;
+    typedef Tag tag;
+
+    static Functor const& make(Functor const& get_key) {
+        return get_key;
+    }
+};
+
+template <typename Functor, typename Key>
+struct engine_key<Functor, Key, traits_tag> {
+    typedef get_radix_key<Functor, Key> type;
+    typedef unsigned_tag tag;
+
+    static type make(Functor const& get_key) {
+        return type(get_key);
+    }
+};
+
+// [first, last) is made of n blocks P_i followed by n blocks T_i with
+// p_sizes[i] and t_sizes[i] elements; reorders it to P_0 T_0 ... P_n-1 T_n-1.
+template <typename Iterator, typename Diff>
+void interleave_blocks(Iterator first, Diff const* p_sizes, Diff const* t_sizes, std::size_t n)
 {
-    typedef typename std::iterator_traits<Iterator>::value_type value_t;
-    ::inplace_radixxx::sort(first, last, detail::id());
+    if (n < 2)
+        return;
+    std::size_t const half = n / 2;
+    Diff a = 0, b = 0, c = 0;
+    for (std::size_t i = 0; i < half; ++i)
+        a += p_sizes[i], c += t_sizes[i];
+    for (std::size_t i = half; i < n; ++i)
+        b += p_sizes[i];
+    Iterator middle = first;
+    std::advance(middle, a);
+    Iterator second = middle;
+    std::advance(second, b);
+    Iterator last = second;
+    std::advance(last, c);
+    if (b != 0 && c != 0)
+        std::rotate(middle, second, last);
+    interleave_blocks(first, p_sizes, t_sizes, half);
+    std::advance(first, a + c);
+    interleave_blocks(first, p_sizes + half, t_sizes + half, n - half);
 }
 
 template <typename Iterator>
-inline void rsort(Iterator first, Iterator last)
+inline Iterator prior(Iterator it)
+{
+    return --it;
+}
+
+template <typename Iterator, typename Predicate>
+Iterator partition_point(Iterator first, Iterator last, Predicate const& pred)
+{
+    typedef typename std::iterator_traits<Iterator>::difference_type diff_t;
+    for (diff_t len = std::distance(first, last); len > 0; ) {
+        diff_t const half = len / 2;
+        Iterator middle = first;
+        std::advance(middle, half);
+        if (pred(*middle)) {
+            first = ++middle;
+            len -= half + 1;
+        } else {
+            len = half;
+        }
+    }
+    return first;
+}
+
+template <typename Functor, typename T>
+struct digit_at_most {
+    digit_at_most(Functor const& get_key, T mask, std::size_t shift, std::size_t digit)
+        : digit_(get_key, mask, shift), max_(digit)
+    {}
+
+    template <typename U>
+    bool operator()(U const& x) const {
+        return digit_(x) <= max_;
+    }
+
+private:
+    radix_digit<Functor, T> digit_;
+    std::size_t max_;
+};
+
+// Stores in sizes[i] the number of elements of the sorted range
+// [first, last) whose digit is i.
+template <typename Iterator, typename T, typename Functor>
+void digit_bounds(Iterator first, Iterator last, T mask, std::size_t shift,
+                  Functor const& get_key,
+                  typename std::iterator_traits<Iterator>::difference_type* sizes)
+{
+    for (std::size_t i = 0; i < nbuckets; ++i) {
+        Iterator it = detail::partition_point(
+            first, last, digit_at_most<Functor, T>(get_key, mask, shift, i));
+        sizes[i] = std::distance(first, it);
+        first = it;
+    }
+}
+
+// Merges the sorted ranges [first, middle) and [middle, last) digit by
+// digit: the blocks of equal top digit are brought next to each other by
+// rotations and then merged independently on the next digit.
+template <typename Iterator, typename T, typename Functor>
+void merge_impl(Iterator first, Iterator middle, Iterator last, T mask, std::size_t shift,
+                Functor const& get_key, unsigned_tag tag)
+{
+    typedef typename std::iterator_traits<Iterator>::difference_type diff_t;
+    compare_key<Functor> cmp(get_key);
+    if (first == middle || middle == last || !cmp(*middle, *prior(middle)))
+        return;
+    if (std::distance(first, last) <= diff_t(4 * nbuckets)) {
+        std::inplace_merge(first, middle, last, cmp);
+        return;
+    }
+
+    diff_t p_sizes[nbuckets], t_sizes[nbuckets];
+    digit_bounds(first, middle, mask, shift, get_key, p_sizes);
+    digit_bounds(middle, last, mask, shift, get_key, t_sizes);
+    interleave_blocks(first, p_sizes, t_sizes, nbuckets);
+    if (mask >>= nbits) {
+        shift -= nbits;
+        for (std::size_t i = 0; i < nbuckets; ++i) {
+            middle = first;
+            std::advance(middle, p_sizes[i]);
+            last = middle;
+            std::advance(last, t_sizes[i]);
+            merge_impl(first, middle, last, mask, shift, get_key, tag);
+            first = last;
+        }
+    }
+}
+
+template <typename Iterator, typename T, typename Functor>
+void merge_impl(Iterator first, Iterator middle, Iterator last, T mask, std::size_t shift,
+                Functor const& get_key, signed_tag)
+{
+    key_is_negative<Functor> const negative(get_key);
+    Iterator const p = detail::partition_point(first, middle, negative);
+    Iterator const t = detail::partition_point(middle, last, negative);
+    Iterator split = p;
+    std::advance(split, std::distance(middle, t));
+    std::rotate(p, middle, t);
+    merge_impl(first, p, split, mask, shift, get_key, unsigned_tag());
+    merge_impl(split, t, last, mask, shift, get_key, unsigned_tag());
+}
+
+template <typename Iterator, typename T, typename Functor, typename Tag>
+inline void merge_impl(Iterator first, Iterator middle, Iterator last, T, std::size_t,
+                       Functor const& get_key, Tag)
+{
+    std::inplace_merge(first, middle, last, compare_key<Functor>(get_key));
+}
+
+template <typename Iterator, typename BufferIterator, typename Functor>
+void merge_with_buffer(Iterator first, Iterator middle, Iterator last, BufferIterator buffer,
+                       Functor const& get_key)
+{
+    if (first == middle || middle == last)
+        return;
+    compare_key<Functor> cmp(get_key);
+    BufferIterator buffer_last = std::copy(middle, last, buffer);
+    while (buffer_last != buffer) {
+        if (middle != first && cmp(*prior(buffer_last), *prior(middle)))
+            *--last = *--middle;
+        else
+            *--last = *--buffer_last;
+    }
+}
+
+// Orders keys the way the engine does, which for key_traits types is by
+// their radix key.
+template <typename Key, typename Tag>
+struct key_less {
+    static bool less(Key const& x, Key const& y) {
+        return x < y;
+    }
+};
+
+template <typename Key>
+struct key_less<Key, traits_tag> {
+    static bool less(Key const& x, Key const& y) {
+        return key_traits<Key>::to_radix(x) < key_traits<Key>::to_radix(y);
+    }
+};
+
+template <typename Functor, typename Key, typename Tag>
+struct element_before_key {
+    explicit element_before_key(Functor const& get_key) : get_key_(get_key) {}
+
+    template <typename T>
+    bool operator()(T const& x, Key const& key) const {
+        return key_less<Key, Tag>::less(get_key_(x), key);
+    }
+
+private:
+    Functor get_key_;
+};
+
+template <typename Functor, typename Key, typename Tag>
+struct key_before_element {
+    explicit key_before_element(Functor const& get_key) : get_key_(get_key) {}
+
+    template <typename T>
+    bool operator()(Key const& key, T const& x) const {
+        return key_less<Key, Tag>::less(key, get_key_(x));
+    }
+
+private:
+    Functor get_key_;
+};
+
+template <typename T, typename R>
+class mem_fun_ptr_wrapper {
+    typedef R (T::*mem_fun_ptr)();
+
+public:
+    typedef R result_type;
+
+    explicit mem_fun_ptr_wrapper(mem_fun_ptr p)
+        : p_(p)
+    {}
+
+    result_type operator()(T& t) const {
+        return (t.*p_)();
+    }
+    result_type operator()(T* t) const {
+        return (t->*p_)();
+    }
+
+private:
+    mem_fun_ptr p_;
+};
+
+template <typename T, typename R>
+class mem_fun_const_ptr_wrapper {
+    typedef R (T::*mem_fun_ptr)() const;
+
+public:
+    typedef R result_type;
+
+    explicit mem_fun_const_ptr_wrapper(mem_fun_ptr p)
+        : p_(p)
+    {}
+
+    result_type operator()(T const& t) const {
+        return (t.*p_)();
+    }
+    result_type operator()(T const* t) const {
+        return (t->*p_)();
+    }
+
+private:
+    mem_fun_ptr p_;
+};
+
+template <typename T, typename U>
+class mem_ptr_wrapper {
+public:
+    typedef U result_type;
+
+    explicit mem_ptr_wrapper(U T::* p)
+        : p_(p)
+    {}
+
+    result_type operator()(T const& t) const {
+        return t.*p_;
+    }
+    result_type operator()(T const* t) const {
+        return t->*p_;
+    }
+
+private:
+    U T::* p_;
+};
+
+template <typename T>
+T& mem_fn_(T& t)
+{
+    return t;
+}
+
+template <typename T>
+T const& mem_fn_(T const& t)
+{
+    return t;
+}
+
+template <typename T, typename R>
+mem_fun_ptr_wrapper<T, R> mem_fn_(R (T::*p)())
+{
+    return mem_fun_ptr_wrapper<T, R>(p);
+}
+
+template <typename T, typename R>
+mem_fun_const_ptr_wrapper<T, R> mem_fn_(R (T::*p)() const)
+{
+    return mem_fun_const_ptr_wrapper<T, R>(p);
+}
+
+template <typename T, typename U>
+mem_ptr_wrapper<T, U> mem_fn_(U T::* p)
+{
+    return mem_ptr_wrapper<T, U>(p);
+}
+
+template <typename T>
+struct mem_fn_type {
+    typedef T type;
+};
+
+template <typename T, typename R>
+struct mem_fn_type<R (T::*)()> {
+    typedef mem_fun_ptr_wrapper<T, R> type;
+};
+
+template <typename T, typename R>
+struct mem_fn_type<R (T::*)() const> {
+    typedef mem_fun_const_ptr_wrapper<T, R> type;
+};
+
+template <typename T, typename U>
+struct mem_fn_type<U T::*> {
+    typedef mem_ptr_wrapper<T, U> type;
+};
+
+// What the algorithms derive from an iterator and the key functor applied
+// to its elements.
+template <typename Iterator, typename Functor>
+struct key_types {
+    typedef typename std::iterator_traits<Iterator>::value_type value_t;
+    typedef typename result_of<Functor (value_t)>::type key_t;
+    typedef typename get_tag<key_t>::type tag;
+    typedef initial_mask<typename make_unsigned<key_t>::type, tag> mask;
+    typedef initial_shift<key_t, tag> shift;
+    typedef typename mem_fn_type<Functor>::type get_key_t;
+};
+} // namespace detail
+
+#if __GXX_EXPERIMENTAL_CXX0X__
+namespace detail {
+template <typename Int>
+struct integral_key_traits {
+    typedef typename std::make_unsigned<Int>::type radix_type;
+    static std::size_t const bits = sizeof(Int) * CHAR_BIT;
+
+    static radix_type to_radix(Int x) {
+        // Flipping the sign bit maps two's complement order onto unsigned order.
+        return std::is_signed<Int>::value
+            ? radix_type(radix_type(x) ^ (radix_type(1) << (bits - 1)))
+            : radix_type(x);
+    }
+};
+} // namespace detail
+
+template <typename Enum>
+struct key_traits<Enum, typename std::enable_if<std::is_enum<Enum>::value>::type>
+    : detail::integral_key_traits<typename std::underlying_type<Enum>::type>
+{
+    typedef typename std::underlying_type<Enum>::type underlying_t;
+    typedef detail::integral_key_traits<underlying_t> base;
+
+    static typename base::radix_type to_radix(Enum e) {
+        return base::to_radix(static_cast<underlying_t>(e));
+    }
+};
+
+template <typename Rep, typename Period>
+struct key_traits<std::chrono::duration<Rep, Period>,
+                  typename std::enable_if<std::is_integral<Rep>::value>::type>
+    : detail::integral_key_traits<Rep>
+{
+    typedef detail::integral_key_traits<Rep> base;
+
+    static typename base::radix_type to_radix(std::chrono::duration<Rep, Period> const& d) {
+        return base::to_radix(d.count());
+    }
+};
+
+template <typename Clock, typename Duration>
+struct key_traits<std::chrono::time_point<Clock, Duration>,
+                  typename std::enable_if<std::is_integral<typename Duration::rep>::value>::type>
+    : key_traits<Duration>
+{
+    typedef key_traits<Duration> base;
+
+    static typename base::radix_type to_radix(std::chrono::time_point<Clock, Duration> const& t) {
+        return base::to_radix(t.time_since_epoch());
+    }
+};
+#endif // #if __GXX_EXPERIMENTAL_CXX0X__
+
+template <typename Iterator, typename Functor>
+inline void sort(Iterator first, Iterator last, Functor get_key)
+{
+    typedef detail::key_types<Iterator, Functor> types;
+
+    detail::sort_impl(first, last,
+                      types::mask::value,
+                      types::shift::value,
+                      detail::mem_fn_(get_key),
+                      typename types::tag());
+}
+
+namespace detail {
+struct id {
+    template <typename T>
+    struct result;
+
+    template <typename Functor, typename T>
+    struct result<Functor (T)> {
+        typedef T type;
+    };
+
+    template <typename T>
+    T const& operator()(T const& x) const {
+        return x;
+    };
+};
+
+// Elements that are their own key and equal to each other are
+// indistinguishable, so integers of up to 16 bits can be sorted by counting
+// each value once and rewriting the range from the histogram.
+template <typename Int, typename Tag>
+struct is_counting_sortable {
+    static bool const value = false;
+};
+
+template <typename Int>
+struct is_counting_sortable<Int, unsigned_tag> {
+    static bool const value = sizeof(Int) * CHAR_BIT <= 16;
+};
+
+template <typename Int>
+struct is_counting_sortable<Int, signed_tag> : is_counting_sortable<Int, unsigned_tag> {};
+
+template <bool>
+struct counting_sort_tag {};
+
+template <typename Iterator>
+inline void sort_identity(Iterator first, Iterator last, counting_sort_tag<false>)
+{
+    ::inplace_radixxx::sort(first, last, id());
+}
+
+// Rewrites [first, last) from count_, the number of occurrences of every
+// value indexed with its sign bit flipped.
+template <typename Iterator, typename Count>
+void counting_rewrite(Iterator first, Count const& count_)
+{
+    typedef typename std::iterator_traits<Iterator>::value_type value_t;
+    typedef typename make_unsigned<value_t>::type uvalue_t;
+
+    std::size_t const nvalues = std::size_t(1) << (sizeof(value_t) * CHAR_BIT);
+    uvalue_t const flip = value_t(-1) < 0 ? uvalue_t(nvalues >> 1) : uvalue_t(0);
+    for (std::size_t i = 0; i < nvalues; ++i) {
+        std::fill_n(first, count_[i], value_t(uvalue_t(i ^ flip)));
+        std::advance(first, count_[i]);
+    }
+}
+
+template <typename Iterator, typename Count>
+void counting_count(Iterator first, Iterator last, Count& count_)
+{
+    typedef typename std::iterator_traits<Iterator>::value_type value_t;
+    typedef typename make_unsigned<value_t>::type uvalue_t;
+
+    // Flipping the sign bit turns the value order into index order.
+    std::size_t const nvalues = std::size_t(1) << (sizeof(value_t) * CHAR_BIT);
+    uvalue_t const flip = value_t(-1) < 0 ? uvalue_t(nvalues >> 1) : uvalue_t(0);
+    for (Iterator it = first; it != last; ++it)
+        ++count_[uvalue_t(uvalue_t(*it) ^ flip)];
+}
+
+template <bool>
+struct counting_table_tag {};
+
+// Walking all nbuckets counters only pays off once the range is about
+// half as long.
+template <typename Iterator>
+void counting_sort(Iterator first, Iterator last, counting_table_tag<true>)
+{
+    typedef typename std::iterator_traits<Iterator>::difference_type diff_t;
+    if (std::distance(first, last) < diff_t(nbuckets / 2)) {
+        ::inplace_radixxx::sort(first, last, id());
+        return;
+    }
+    std::size_t count_[nbuckets] = {};
+    counting_count(first, last, count_);
+    counting_rewrite(first, count_);
+}
+
+// Wider types need a 65536-entry table, which is allocated and pays off
+// from about an eighth of its size.
+template <typename Iterator>
+void counting_sort(Iterator first, Iterator last, counting_table_tag<false>)
+{
+    typedef typename std::iterator_traits<Iterator>::difference_type diff_t;
+    typedef typename std::iterator_traits<Iterator>::value_type value_t;
+
+    std::size_t const nvalues = std::size_t(1) << (sizeof(value_t) * CHAR_BIT);
+    diff_t const n = std::distance(first, last);
+    if (n < diff_t(nvalues / 8)) {
+        ::inplace_radixxx::sort(first, last, id());
+        return;
+    }
+    // Narrower counters halve the table whenever they cannot overflow.
+    if (static_cast<unsigned long>(n) <= UINT_MAX) {
+        std::vector<unsigned> count_(nvalues);
+        counting_count(first, last, count_);
+        counting_rewrite(first, count_);
+    } else {
+        std::vector<std::size_t> count_(nvalues);
+        counting_count(first, last, count_);
+        counting_rewrite(first, count_);
+    }
+}
+
+template <typename Iterator>
+inline void sort_identity(Iterator first, Iterator last, counting_sort_tag<true>)
+{
+    typedef typename std::iterator_traits<Iterator>::value_type value_t;
+    counting_sort(first, last, counting_table_tag<sizeof(value_t) * CHAR_BIT <= nbits>());
+}
+} // namespace detail
+
+// Sorts elements by their own value.  For integers of at most 16 bits this
+// counts every value and rewrites the range; with 16-bit types and at least
+// 8192 elements that takes a 65536-entry counter table from the heap, so
+// unlike the other sorts it may throw std::bad_alloc.
+template <typename Iterator>
+inline void sort(Iterator first, Iterator last)
+{
+    typedef typename std::iterator_traits<Iterator>::value_type value_t;
+    typedef typename detail::get_tag<value_t>::type tag;
+    detail::sort_identity(first, last,
+                          detail::counting_sort_tag<detail::is_counting_sortable<value_t, tag>::value>());
+}
+
+template <typename Iterator>
+inline void rsort(Iterator first, Iterator last)
 {
     typedef std::reverse_iterator<Iterator> riterator;
     ::inplace_radixxx::sort(riterator(last), riterator(first));
@@ -446,5 +1212,868 @@ inline void rsort(Iterator first, Iterator last, Functor get_key)
     typedef std::reverse_iterator<Iterator> riterator;
     ::inplace_radixxx::sort(riterator(last), riterator(first), get_key);
 }
+
+// A view of [first, last) that is sorted on demand.  The constructor does
+// the first radix pass only; every bucket is sorted when an iterator first
+// reaches it, so reading a prefix costs little more than one pass and
+// reading everything costs about as much as sort().  Keys without a radix
+// mapping get no radix pass: they form a single bucket, which the first
+// begin() sorts in full.  The underlying range must not be touched while
+// the view is alive.
+template <typename Iterator, typename Functor = detail::id>
+class lazy_sorted_range {
+    typedef detail::key_types<Iterator, Functor> types;
+    typedef typename types::value_t value_t;
+    typedef typename types::key_t key_t;
+    typedef typename types::tag tag;
+    typedef typename types::mask mask;
+    typedef typename types::shift shift;
+    typedef typename types::get_key_t get_key_t;
+
+public:
+    class iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename std::iterator_traits<Iterator>::value_type value_type;
+        typedef typename std::iterator_traits<Iterator>::difference_type difference_type;
+        typedef typename std::iterator_traits<Iterator>::pointer pointer;
+        typedef typename std::iterator_traits<Iterator>::reference reference;
+
+        iterator() : range_(0), bucket_(0) {}
+
+        reference operator*() const {
+            return *it_;
+        }
+        pointer operator->() const {
+            return &*it_;
+        }
+
+        iterator& operator++() {
+            if (++it_ == bucket_end_)
+                enter_bucket();
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        // The position in the underlying range; everything before it is
+        // already in its final place.
+        Iterator base() const {
+            return it_;
+        }
+
+        friend bool operator==(iterator const& x, iterator const& y) {
+            return x.it_ == y.it_;
+        }
+        friend bool operator!=(iterator const& x, iterator const& y) {
+            return x.it_ != y.it_;
+        }
+
+    private:
+        friend class lazy_sorted_range;
+
+        iterator(lazy_sorted_range* range, Iterator it, std::size_t bucket)
+            : range_(range), it_(it), bucket_end_(it), bucket_(bucket)
+        {}
+
+        // Moves to the first non-empty bucket at or after it_ and sorts it.
+        void enter_bucket() {
+            std::size_t const n = range_->bounds_.size() - 1;
+            while (bucket_ < n && it_ == range_->bounds_[bucket_ + 1])
+                ++bucket_;
+            bucket_end_ = range_->bounds_[bucket_ < n ? bucket_ + 1 : n];
+            if (bucket_ < n)
+                range_->sort_bucket(bucket_);
+        }
+
+        lazy_sorted_range* range_;
+        Iterator it_;
+        Iterator bucket_end_;
+        std::size_t bucket_;
+    };
+
+    lazy_sorted_range(Iterator first, Iterator last)
+        : get_key_(detail::mem_fn_(Functor()))
+    {
+        init(first, last);
+    }
+
+    lazy_sorted_range(Iterator first, Iterator last, Functor get_key)
+        : get_key_(detail::mem_fn_(get_key))
+    {
+        init(first, last);
+    }
+
+#if __GXX_EXPERIMENTAL_CXX0X__
+    // With prefetching enabled, the bucket after the one being entered is
+    // sorted by a background thread while the caller reads the current one.
+    void prefetch(bool enable) {
+        prefetch_ = enable;
+    }
+#endif
+
+    iterator begin() {
+        iterator it(this, bounds_.front(), 0);
+        it.enter_bucket();
+        return it;
+    }
+
+    iterator end() {
+        return iterator(this, bounds_.back(), bounds_.size() - 1);
+    }
+
+private:
+    lazy_sorted_range(lazy_sorted_range const&);
+    lazy_sorted_range& operator=(lazy_sorted_range const&);
+
+    void init(Iterator first, Iterator last) {
+#if __GXX_EXPERIMENTAL_CXX0X__
+        prefetch_ = false;
+#endif
+        bounds_.push_back(first);
+        detail::partition_top(first, last, mask::value, shift::value, get_key_, bounds_, tag());
+        sorted_.resize(bounds_.size() - 1);
+    }
+
+    void sort_bucket(std::size_t i) {
+#if __GXX_EXPERIMENTAL_CXX0X__
+        if (pending_.valid() && pending_bucket_ == i)
+            pending_.get();
+#endif
+        if (!sorted_[i]) {
+            sorted_[i] = true;
+            detail::sort_rest(bounds_[i], bounds_[i + 1], mask::value, shift::value, get_key_, tag());
+        }
+#if __GXX_EXPERIMENTAL_CXX0X__
+        if (prefetch_ && !pending_.valid()) {
+            std::size_t j = i + 1;
+            while (j < sorted_.size() && (sorted_[j] || bounds_[j] == bounds_[j + 1]))
+                ++j;
+            if (j < sorted_.size()) {
+                sorted_[j] = true;
+                pending_bucket_ = j;
+                pending_ = std::async(std::launch::async, [this, j] {
+                    detail::sort_rest(bounds_[j], bounds_[j + 1], mask::value, shift::value,
+                                      get_key_, tag());
+                });
+            }
+        }
+#endif
+    }
+
+    get_key_t get_key_;
+    std::vector<Iterator> bounds_;
+    std::vector<bool> sorted_;
+#if __GXX_EXPERIMENTAL_CXX0X__
+    bool prefetch_;
+    std::size_t pending_bucket_;
+    std::future<void> pending_;
+#endif
+};
+
+// The bucket directory left behind by sort_and_index().  Lookups go
+// straight to the bucket of the key's top digits and binary search only
+// within it.  The index refers to the sorted range and is invalidated by
+// anything that reorders or resizes it.
+template <typename Iterator, typename Functor = detail::id>
+class radix_index {
+    typedef detail::key_types<Iterator, Functor> types;
+    typedef typename types::value_t value_t;
+    typedef typename types::key_t key_t;
+    typedef typename types::tag tag;
+    typedef typename types::mask mask;
+    typedef typename types::shift shift;
+    typedef typename types::get_key_t get_key_t;
+
+public:
+    typedef key_t key_type;
+
+    // Sorts [first, last) and indexes the top `levels` digits; levels above
+    // 2 are treated as 2.
+    radix_index(Iterator first, Iterator last, Functor get_key, std::size_t levels)
+        : get_key_(detail::mem_fn_(get_key)),
+          mask_(mask::value),
+          shift_(shift::value)
+    {
+        levels = std::min(levels, detail::max_levels);
+        std::size_t n = 1;
+        while (n < levels && shift_ >= detail::nbits) {
+            mask_ |= mask_ >> detail::nbits;
+            shift_ -= detail::nbits;
+            ++n;
+        }
+        bounds_.push_back(first);
+        detail::index_impl(first, last, mask::value, shift::value, get_key_, n, bounds_, tag());
+    }
+
+    Iterator begin() const {
+        return bounds_.front();
+    }
+
+    Iterator end() const {
+        return bounds_.back();
+    }
+
+    std::size_t bucket_count() const {
+        return bounds_.size() - 1;
+    }
+
+    Iterator lower_bound(key_type const& key) const {
+        std::size_t const i = bucket(key);
+        return std::lower_bound(bounds_[i], bounds_[i + 1], key,
+                                detail::element_before_key<get_key_t, key_t, tag>(get_key_));
+    }
+
+    Iterator upper_bound(key_type const& key) const {
+        std::size_t const i = bucket(key);
+        return std::upper_bound(bounds_[i], bounds_[i + 1], key,
+                                detail::key_before_element<get_key_t, key_t, tag>(get_key_));
+    }
+
+    std::pair<Iterator, Iterator> equal_range(key_type const& key) const {
+        return std::make_pair(lower_bound(key), upper_bound(key));
+    }
+
+private:
+    std::size_t bucket(key_type const& key) const {
+        return detail::bucket_of(key, mask_, shift_, bucket_count(), tag());
+    }
+
+    get_key_t get_key_;
+    typename mask::type mask_;
+    std::size_t shift_;
+    std::vector<Iterator> bounds_;
+};
+
+// Sorts [first, last) and returns an index over it.  The directory holds one
+// bound per bucket of the top `levels` digits (1 or 2): 256 or 65536
+// buckets, twice that for signed keys, regardless of the size of the range.
+// Keys without a radix mapping get a single bucket.
+template <typename Iterator, typename Functor>
+inline radix_index<Iterator, Functor>
+sort_and_index(Iterator first, Iterator last, Functor get_key, std::size_t levels)
+{
+    return radix_index<Iterator, Functor>(first, last, get_key, levels);
+}
+
+template <typename Iterator, typename Functor>
+inline radix_index<Iterator, Functor>
+sort_and_index(Iterator first, Iterator last, Functor get_key)
+{
+    return radix_index<Iterator, Functor>(first, last, get_key, 1);
+}
+
+template <typename Iterator>
+inline radix_index<Iterator> sort_and_index(Iterator first, Iterator last)
+{
+    return radix_index<Iterator>(first, last, detail::id(), 1);
+}
+
+// Splits keys into globally ordered, roughly equal parts across shards that
+// are sorted separately, e.g. by different processes:
+//
+//  1. every shard bounds its keys with key_range(); the ranges of all
+//     shards are merged and passed to focus() in every shard,
+//  2. every shard adds its keys to a histogram over the top `levels` digits
+//     of that range (histogram_size() counters; histograms of all shards
+//     are summed),
+//  3. choose_splitters() picks nparts - 1 bucket boundaries from the sum,
+//  4. every shard partition()s itself in place by those splitters.
+//
+// Part p of every shard then only holds keys that are greater than those in
+// part p - 1 of any shard.  Parts are balanced to bucket granularity: 256
+// buckets per level, at most 2 levels.  Step 1 may be skipped, in which case
+// the buckets cover the whole width of the key and keys confined to a narrow
+// range, e.g. 64-bit timestamps, share few of them.  Ranges, histograms and
+// splitters are plain arrays and can live in memory shared between
+// processes.  Keys without a radix mapping all fall into a single bucket.
+template <typename Iterator, typename Functor = detail::id>
+class shard_partitioner {
+    typedef detail::key_types<Iterator, Functor> types;
+    typedef typename types::value_t value_t;
+    typedef typename types::key_t key_t;
+    typedef typename types::tag tag;
+    typedef typename types::get_key_t get_key_t;
+    typedef detail::ordered_radix<key_t, tag> radix;
+
+public:
+    // Unsigned integers ordered like the keys, in which key ranges are given.
+    typedef typename radix::type radix_type;
+
+    // Levels above 2 are treated as 2.
+    explicit shard_partitioner(std::size_t levels = 1)
+        : get_key_(detail::mem_fn_(Functor()))
+    {
+        init(levels);
+    }
+
+    shard_partitioner(Functor get_key, std::size_t levels)
+        : get_key_(detail::mem_fn_(get_key))
+    {
+        init(levels);
+    }
+
+    // Widens range[0, 2) to the keys of [first, last): range[0] holds the
+    // complement of the smallest radix key and range[1] the largest, so a
+    // zero-filled range is empty and the ranges of several shards merge by
+    // taking the maximum of each entry.
+    void key_range(Iterator first, Iterator last, radix_type* range) const {
+        for (; first != last; ++first) {
+            radix_type const r = radix::get(get_key_(*first));
+            range[0] = std::max(range[0], radix_type(~r));
+            range[1] = std::max(range[1], r);
+        }
+    }
+
+    // Spreads the buckets over the merged range of all shards.  Every shard
+    // must focus() on the same range before histogram() and partition().
+    void focus(radix_type const* range) {
+        radix_type const lo = radix_type(~range[0]);
+        if (range[1] < lo)
+            return;
+        radix_type const span = radix_type(range[1] - lo);
+        lo_ = lo;
+        shift_ = 0;
+        while (radix_type(span >> shift_) > radix_type(size_ - 1))
+            ++shift_;
+    }
+
+    std::size_t histogram_size() const {
+        return size_;
+    }
+
+    // Adds the keys of [first, last) to counts[0, histogram_size()).
+    void histogram(Iterator first, Iterator last, std::size_t* counts) const {
+        for (; first != last; ++first)
+            ++counts[bucket(get_key_(*first))];
+    }
+
+    // Writes to splitters[0, nparts - 1) the first bucket of every part but
+    // the first, so that the parts hold about the same number of keys.
+    void choose_splitters(std::size_t const* counts, std::size_t nparts,
+                          std::size_t* splitters) const {
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < size_; ++i)
+            total += counts[i];
+        std::size_t b = 0, sum = 0;
+        for (std::size_t p = 1; p < nparts; ++p) {
+            std::size_t const target = total / nparts * p + total % nparts * p / nparts;
+            while (b < size_ && sum + counts[b] / 2 < target)
+                sum += counts[b++];
+            splitters[p-1] = b;
+        }
+    }
+
+    // Permutes [first, last) into nparts parts by splitters; bounds[0] is
+    // set to first and bounds[p + 1] to the end of part p.
+    void partition(Iterator first, Iterator last, std::size_t const* splitters,
+                   std::size_t nparts, Iterator* bounds) const {
+        std::vector<std::size_t> part_of_bucket(size_);
+        for (std::size_t p = 0, b = 0; b < size_; ++b) {
+            while (p + 1 < nparts && splitters[p] <= b)
+                ++p;
+            part_of_bucket[b] = p;
+        }
+        std::vector<std::size_t> count_(nparts);
+        std::vector<Iterator> its(nparts);
+        bounds[0] = first;
+        detail::permute_by(first, last, part_of(*this, part_of_bucket), nparts,
+                           &count_[0], &its[0], bounds + 1);
+    }
+
+private:
+    struct part_of {
+        part_of(shard_partitioner const& self, std::vector<std::size_t> const& part_of_bucket)
+            : self_(self), part_of_bucket_(part_of_bucket)
+        {}
+
+        std::size_t operator()(value_t const& x) const {
+            return part_of_bucket_[self_.bucket(self_.get_key_(x))];
+        }
+
+    private:
+        shard_partitioner const& self_;
+        std::vector<std::size_t> const& part_of_bucket_;
+    };
+
+    void init(std::size_t levels) {
+        std::size_t const digits = radix::digits;
+        std::size_t n = std::min<std::size_t>(digits, 1);
+        while (n < levels && n < detail::max_levels && n < digits)
+            ++n;
+        lo_ = 0;
+        shift_ = (digits - n) * detail::nbits;
+        size_ = std::size_t(1) << n * detail::nbits;
+    }
+
+    // Keys outside the focused range go to the first or last bucket.
+    std::size_t bucket(key_t const& key) const {
+        radix_type const r = radix::get(key);
+        if (r < lo_)
+            return 0;
+        radix_type const b = radix_type(radix_type(r - lo_) >> shift_);
+        return b > radix_type(size_ - 1) ? size_ - 1 : std::size_t(b);
+    }
+
+    get_key_t get_key_;
+    radix_type lo_;
+    std::size_t shift_;
+    std::size_t size_;
+};
+
+namespace detail {
+template <typename Iterator, typename Functor>
+inline void trim_merge(Iterator& first, Iterator middle, Iterator& last, Functor const& get_key)
+{
+    // Only prefix elements greater than the smallest new key and new
+    // elements less than the largest prefix key have to move.
+    compare_key<Functor> cmp(get_key);
+    first = std::upper_bound(first, middle, *middle, cmp);
+    last = std::lower_bound(middle, last, *prior(middle), cmp);
+}
+} // namespace detail
+
+// Sorts the newly appended elements [middle, last) and merges them into the
+// already sorted [first, middle).  Elements of the prefix stay in front of
+// new elements with equal keys.  The merge is done in place, by rotating
+// blocks of equal top digits next to each other and merging those.
+template <typename Iterator, typename Functor>
+void sort_append(Iterator first, Iterator middle, Iterator last, Functor get_key)
+{
+    typedef detail::key_types<Iterator, Functor> types;
+    typedef detail::engine_key<typename types::get_key_t, typename types::key_t,
+                               typename types::tag> engine;
+
+    ::inplace_radixxx::sort(middle, last, get_key);
+    if (first == middle || middle == last)
+        return;
+    typename engine::type const key = engine::make(detail::mem_fn_(get_key));
+    detail::trim_merge(first, middle, last, key);
+    detail::merge_impl(first, middle, last,
+                       types::mask::value, types::shift::value, key, typename engine::tag());
+}
+
+template <typename Iterator>
+inline void sort_append(Iterator first, Iterator middle, Iterator last)
+{
+    ::inplace_radixxx::sort_append(first, middle, last, detail::id());
+}
+
+// As above, but merges through `buffer`, which must have room for
+// last - middle elements; this moves each element at most twice.
+template <typename Iterator, typename Functor, typename BufferIterator>
+void sort_append(Iterator first, Iterator middle, Iterator last, Functor get_key,
+                 BufferIterator buffer)
+{
+    typedef detail::key_types<Iterator, Functor> types;
+    typedef detail::engine_key<typename types::get_key_t, typename types::key_t,
+                               typename types::tag> engine;
+
+    ::inplace_radixxx::sort(middle, last, get_key);
+    if (first == middle || middle == last)
+        return;
+    typename engine::type const key = engine::make(detail::mem_fn_(get_key));
+    detail::trim_merge(first, middle, last, key);
+    detail::merge_with_buffer(first, middle, last, buffer, key);
+}
+
+namespace detail {
+template <typename Key>
+inline bool partitions_front(Key const& key, signed_tag)
+{
+    return key < 0;
+}
+
+template <typename Key>
+inline bool partitions_front(Key const& key, bool_tag)
+{
+    return !key;
+}
+
+// Only reached for the tags above; these keep the state machine compiling
+// for the others.
+template <typename Key, typename Tag>
+inline bool partitions_front(Key const&, Tag)
+{
+    return false;
+}
+
+template <typename Key, typename T, typename Tag>
+inline std::size_t digit_of(Key const& key, T mask, std::size_t shift, Tag)
+{
+    return (key & mask) >> shift;
+}
+
+template <typename Key, typename T>
+inline std::size_t digit_of(Key const&, T, std::size_t, others_tag)
+{
+    return 0;
+}
+} // namespace detail
+
+// The same sort as sort(), run as a state machine that can be advanced in
+// bounded slices:
+//
+//     resumable_sort<Iterator> s(first, last);
+//     while (!s.step(10000))
+//         handle_requests();
+//
+// One unit of budget is about one element visited by a pass.  A slice
+// overshoots its budget by at most one small range (up to 1024 elements)
+// sorted with std::sort; keys without a radix mapping are sorted with
+// std::sort in a single slice.  The range must not be touched between
+// slices.
+template <typename Iterator, typename Functor = detail::id>
+class resumable_sort {
+    typedef detail::key_types<Iterator, Functor> types;
+    typedef typename types::value_t value_t;
+    typedef typename std::iterator_traits<Iterator>::difference_type diff_t;
+    typedef typename types::key_t key_t;
+    typedef typename types::mask mask;
+    typedef typename types::shift shift;
+    typedef detail::engine_key<typename types::get_key_t, key_t, typename types::tag> engine;
+    typedef typename engine::type engine_key_t;
+    typedef typename engine::tag tag;
+    typedef typename mask::type mask_t;
+
+public:
+    resumable_sort(Iterator first, Iterator last)
+        : get_key_(engine::make(detail::mem_fn_(Functor())))
+    {
+        start(first, last, tag());
+    }
+
+    resumable_sort(Iterator first, Iterator last, Functor get_key)
+        : get_key_(engine::make(detail::mem_fn_(get_key)))
+    {
+        start(first, last, tag());
+    }
+
+    // Does about `budget` units of work and returns whether the range is
+    // sorted (or the sort was cancelled).
+    bool step(std::size_t budget) {
+        while (!done()) {
+            if (current_.phase == idle) {
+                current_ = pending_.back();
+                pending_.pop_back();
+            }
+            if (budget == 0)
+                break;
+            std::size_t const used = run(budget);
+            budget = used < budget ? budget - used : 0;
+        }
+        return done();
+    }
+
+    bool done() const {
+        return current_.phase == idle && pending_.empty();
+    }
+
+    // Drops the remaining work.  The range is left as some permutation of
+    // its original elements.
+    void cancel() {
+        current_.phase = idle;
+        pending_.clear();
+        cancelled_ = true;
+    }
+
+    bool cancelled() const {
+        return cancelled_;
+    }
+
+private:
+    enum phase_t { idle, partition, small, count, permute };
+
+    struct task {
+        task() : phase(idle), bucket(0) {}
+        task(Iterator first_, Iterator last_, mask_t mask_, std::size_t shift_, phase_t phase_)
+            : first(first_), last(last_), mask(mask_), shift(shift_), phase(phase_),
+              it(first_), end(last_), bucket(0)
+        {}
+
+        Iterator first, last;
+        mask_t mask;
+        std::size_t shift;
+        phase_t phase;
+        Iterator it, end;   // partition: [it, end) is left to do; count: it
+        std::size_t bucket; // permute
+    };
+
+    void start(Iterator first, Iterator last, detail::unsigned_tag) {
+        cancelled_ = false;
+        push_radix(first, last, mask::value, shift::value);
+    }
+
+    template <typename Tag>
+    void start(Iterator first, Iterator last, Tag) {
+        cancelled_ = false;
+        pending_.push_back(task(first, last, mask::value, shift::value, partition));
+    }
+
+    void start(Iterator first, Iterator last, detail::others_tag) {
+        cancelled_ = false;
+        pending_.push_back(task(first, last, mask::value, shift::value, small));
+    }
+
+    void push_radix(Iterator first, Iterator last, mask_t mask_, std::size_t shift_) {
+        diff_t const n = std::distance(first, last);
+        if (n < 2)
+            return;
+        pending_.push_back(task(first, last, mask_, shift_,
+                                n <= diff_t(4 * detail::nbuckets) ? small : count));
+    }
+
+    std::size_t digit(value_t const& x) const {
+        return detail::digit_of(get_key_(x), current_.mask, current_.shift, tag());
+    }
+
+    // Runs the current task for up to `budget` units; returns units used.
+    std::size_t run(std::size_t budget) {
+        task& t = current_;
+        std::size_t used = 0;
+        switch (t.phase) {
+        case partition:
+            for (; used < budget && t.it != t.end; ++used) {
+                if (detail::partitions_front(get_key_(*t.it), tag())) {
+                    ++t.it;
+                } else if (!detail::partitions_front(get_key_(*--t.end), tag())) {
+                    continue;
+                } else {
+                    std::iter_swap(t.it, t.end);
+                    ++t.it;
+                }
+            }
+            if (t.it == t.end)
+                finish_partition(tag());
+            break;
+        case small:
+            std::sort(t.first, t.last, detail::compare_key<engine_key_t>(get_key_));
+            used = std::distance(t.first, t.last);
+            t.phase = idle;
+            break;
+        case count:
+            if (t.it == t.first)
+                std::fill(count_, count_ + detail::nbuckets, std::size_t(0));
+            for (; used < budget && t.it != t.last; ++used, ++t.it)
+                ++count_[digit(*t.it)];
+            if (t.it == t.last) {
+                for (std::size_t i = 1; i < detail::nbuckets; ++i)
+                    count_[i] += count_[i-1];
+                for (std::size_t i = 0; i < detail::nbuckets; ++i) {
+                    upper_bounds_[i] = t.first;
+                    std::advance(upper_bounds_[i], count_[i]);
+                }
+                its_[0] = t.first;
+                for (std::size_t i = 1; i < detail::nbuckets; ++i)
+                    its_[i] = upper_bounds_[i-1];
+                t.bucket = 0;
+                t.phase = permute;
+            }
+            break;
+        case permute:
+            while (used < budget && t.bucket < detail::nbuckets) {
+                std::size_t const i = t.bucket;
+                if (its_[i] == upper_bounds_[i]) {
+                    ++t.bucket;
+                    continue;
+                }
+                std::size_t const m = digit(*its_[i]);
+                std::iter_swap(its_[i], its_[m]);
+                ++its_[m];
+                ++used;
+            }
+            if (t.bucket == detail::nbuckets) {
+                t.phase = idle;
+                if (mask_t const next = mask_t(t.mask >> detail::nbits)) {
+                    for (std::size_t i = detail::nbuckets; i-- > 1; )
+                        push_radix(upper_bounds_[i-1], upper_bounds_[i], next,
+                                   t.shift - detail::nbits);
+                    push_radix(t.first, upper_bounds_[0], next, t.shift - detail::nbits);
+                }
+            }
+            break;
+        case idle:
+            break;
+        }
+        return used;
+    }
+
+    void finish_partition(detail::signed_tag) {
+        current_.phase = idle;
+        push_radix(current_.it, current_.last, current_.mask, current_.shift);
+        push_radix(current_.first, current_.it, current_.mask, current_.shift);
+    }
+
+    template <typename Tag>
+    void finish_partition(Tag) {
+        current_.phase = idle;
+    }
+
+    engine_key_t get_key_;
+    task current_;
+    std::vector<task> pending_;
+    bool cancelled_;
+    std::size_t count_[detail::nbuckets];
+    Iterator its_[detail::nbuckets];
+    Iterator upper_bounds_[detail::nbuckets];
+};
+
+#if __GXX_EXPERIMENTAL_CXX0X__
+namespace detail {
+// Maps every key sort_zip() radix sorts to an unsigned radix key, along
+// with the initial_mask and initial_shift of its top digit.
+template <typename Key, typename Tag>
+struct zip_key_traits : key_traits<Key> {
+    typedef initial_mask<Key, traits_tag> mask;
+    typedef initial_shift<Key, traits_tag> shift;
+};
+
+template <typename Key>
+struct zip_key_traits<Key, unsigned_tag> : integral_key_traits<Key> {
+    typedef typename integral_key_traits<Key>::radix_type radix_type;
+    typedef initial_mask<radix_type, unsigned_tag> mask;
+    typedef initial_shift<radix_type, unsigned_tag> shift;
+};
+
+template <typename Key>
+struct zip_key_traits<Key, signed_tag> : zip_key_traits<Key, unsigned_tag> {};
+
+template <typename Key>
+struct zip_key_traits<Key, bool_tag> {
+    typedef unsigned char radix_type;
+    typedef initial_mask<radix_type, unsigned_tag> mask;
+    typedef initial_shift<radix_type, unsigned_tag> shift;
+
+    static radix_type to_radix(bool x) {
+        return x;
+    }
+};
+
+template <typename Traits>
+struct zip_digit {
+    typedef typename Traits::radix_type radix_t;
+
+    zip_digit(radix_t mask, std::size_t shift) : mask_(mask), shift_(shift) {}
+
+    template <typename Key>
+    std::size_t operator()(Key const& key) const {
+        return (Traits::to_radix(key) & mask_) >> shift_;
+    }
+
+private:
+    radix_t mask_;
+    std::size_t shift_;
+};
+
+template <typename Diff>
+inline void swap_payloads(Diff, Diff) {}
+
+template <typename Diff, typename Payload, typename... Payloads>
+inline void swap_payloads(Diff i, Diff j, Payload payload, Payloads... payloads)
+{
+    std::iter_swap(payload + i, payload + j);
+    swap_payloads(i, j, payloads...);
+}
+
+template <typename Diff, typename KeyIterator, typename... Payloads>
+inline void swap_zip(Diff i, Diff j, KeyIterator keys, Payloads... payloads)
+{
+    std::iter_swap(keys + i, keys + j);
+    swap_payloads(i, j, payloads...);
+}
+
+// Same passes as sort_impl(..., unsigned_tag), with every swap of the key
+// column replayed at the same offsets from `keys` on the payload columns.
+template <typename Traits, typename KeyIterator, typename... Payloads>
+void sort_zip_impl(KeyIterator keys, KeyIterator first, KeyIterator last,
+                   typename Traits::radix_type mask, std::size_t shift,
+                   Payloads... payloads)
+{
+    typedef typename std::iterator_traits<KeyIterator>::difference_type diff_t;
+
+    if (last - first <= diff_t(nbuckets / 8)) {
+        for (diff_t i = first - keys + 1; i < last - keys; ++i)
+            for (diff_t j = i; j > first - keys
+                     && Traits::to_radix(keys[j]) < Traits::to_radix(keys[j-1]); --j)
+                swap_zip(j, j - 1, keys, payloads...);
+        return;
+    }
+
+    std::size_t count_[nbuckets] = {};
+    KeyIterator its[nbuckets], upper_bounds[nbuckets];
+    permute_by(first, last, zip_digit<Traits>(mask, shift), nbuckets, count_, its, upper_bounds,
+               [=](KeyIterator x, KeyIterator y) {
+                   if (x != y)
+                       swap_zip(x - keys, y - keys, keys, payloads...);
+               });
+    if (mask >>= nbits) {
+        shift -= nbits;
+        sort_zip_impl<Traits>(keys, first, upper_bounds[0], mask, shift, payloads...);
+        for (std::size_t i = 1; i < nbuckets; ++i)
+            sort_zip_impl<Traits>(keys, upper_bounds[i-1], upper_bounds[i], mask, shift,
+                                  payloads...);
+    }
+}
+
+template <typename Tag, typename KeyIterator, typename... Payloads>
+inline void sort_zip_dispatch(KeyIterator first, KeyIterator last, Tag, Payloads... payloads)
+{
+    typedef typename std::iterator_traits<KeyIterator>::value_type key_t;
+    typedef zip_key_traits<key_t, Tag> traits;
+    sort_zip_impl<traits>(first, first, last, traits::mask::value, traits::shift::value,
+                          payloads...);
+}
+
+template <typename KeyIterator>
+struct compare_at {
+    explicit compare_at(KeyIterator keys) : keys_(keys) {}
+
+    template <typename Diff>
+    bool operator()(Diff x, Diff y) const {
+        return keys_[x] < keys_[y];
+    }
+
+private:
+    KeyIterator keys_;
+};
+
+// Keys without a radix mapping are ordered through an index permutation,
+// which is then applied cycle by cycle to every column.
+template <typename KeyIterator, typename... Payloads>
+void sort_zip_dispatch(KeyIterator first, KeyIterator last, others_tag, Payloads... payloads)
+{
+    typedef typename std::iterator_traits<KeyIterator>::difference_type diff_t;
+
+    std::vector<diff_t> order(last - first);
+    for (diff_t i = 0; i < last - first; ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), compare_at<KeyIterator>(first));
+    for (diff_t i = 0; i < last - first; ++i) {
+        diff_t j = i;
+        for (diff_t k = order[j]; k != i; k = order[j]) {
+            swap_zip(j, k, first, payloads...);
+            order[j] = j;
+            j = k;
+        }
+        order[j] = j;
+    }
+}
+} // namespace detail
+
+// Sorts the key column [keys_first, keys_last) and applies the same
+// permutation to every payload column starting at payload_first.
+// All iterators must be random access.
+template <typename KeyIterator, typename... PayloadIterators>
+inline void sort_zip(KeyIterator keys_first, KeyIterator keys_last,
+                     PayloadIterators... payload_first)
+{
+    typedef typename std::iterator_traits<KeyIterator>::value_type key_t;
+    typedef typename detail::get_tag<key_t>::type tag;
+    detail::sort_zip_dispatch(keys_first, keys_last, tag(), payload_first...);
+}
+#endif // #if __GXX_EXPERIMENTAL_CXX0X__
 } // namespace inplace_radixxx
 #endif // #ifndef INCLUDE_GUARD_INPLACE_RADIXXX_H_
@@ -6,6 +6,17 @@
 #include <string>
 #include <utility>
 #include <vector>
+#if __unix__
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#if __GXX_EXPERIMENTAL_CXX0X__
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <type_traits>
+#endif
 
 template <typename Iterator>
 bool is_sorted_(Iterator first, Iterator last)
@@ -34,6 +45,21 @@ bool is_sorted_(Iterator first, Iterator last, Functor get_key)
     return true;
 }
 
+struct get_self {
+    template <typename>
+    struct result;
+
+    template <typename Functor, typename T>
+    struct result<Functor (T)> {
+        typedef T type;
+    };
+
+    template <typename T>
+    T const& operator()(T const& x) const {
+        return x;
+    }
+};
+
 struct get_first {
     template <typename>
     struct result;
@@ -168,6 +194,33 @@ TYPED_TEST(ScalarTest, ScalarTest)
     }
 }
 
+template <typename T>
+struct CountingSortTest : ::testing::Test {};
+
+typedef ::testing::Types<std::vector<unsigned char>, std::deque<signed char>,
+                         std::vector<char>, std::vector<unsigned short>,
+                         std::deque<short> >
+    CountingSortTestContainers;
+TYPED_TEST_CASE(CountingSortTest, CountingSortTestContainers);
+
+TYPED_TEST(CountingSortTest, CountingSortTest)
+{
+    typedef TypeParam Container;
+
+    int n = 0;
+    Container c;
+    for (int i = 0; i < 7; ++i) {
+        c.resize(n);
+        for (int j = 0; j < n; ++j)
+            c[j] = rand();
+        Container expected = c;
+        std::sort(expected.begin(), expected.end());
+        inplace_radixxx::sort(c.begin(), c.end());
+        EXPECT_TRUE(c == expected);
+        n = 10*n + 1;
+    }
+}
+
 template <typename T>
 struct ScalarPairFirstTest : ::testing::Test {};
 
@@ -368,6 +421,679 @@ TEST(MemberPointerTest, Object)
     }
 }
 
+struct region_timestamp {
+    unsigned short region;
+    unsigned timestamp;
+};
+
+namespace inplace_radixxx {
+template <>
+struct key_traits<region_timestamp> {
+    typedef unsigned long radix_type;
+    static std::size_t const bits = 48;
+
+    static radix_type to_radix(region_timestamp const& k) {
+        return (radix_type(k.region) << 32) | k.timestamp;
+    }
+};
+} // namespace inplace_radixxx
+
+struct get_region_timestamp {
+    typedef region_timestamp result_type;
+
+    template <typename Payload>
+    region_timestamp const& operator()(std::pair<region_timestamp, Payload> const& x) const {
+        return x.first;
+    }
+};
+
+struct region_timestamp_radix {
+    typedef unsigned long result_type;
+
+    template <typename Payload>
+    result_type operator()(std::pair<region_timestamp, Payload> const& x) const {
+        return inplace_radixxx::key_traits<region_timestamp>::to_radix(x.first);
+    }
+};
+
+TEST(KeyTraitsTest, UserKey)
+{
+    int n = 0;
+    std::vector<std::pair<region_timestamp, int> > v;
+    for (int i = 0; i < 7; ++i) {
+        v.resize(n);
+        for (int j = 0; j < n; ++j) {
+            v[j].first.region = rand() % 16;
+            v[j].first.timestamp = rand();
+            v[j].second = j;
+        }
+        inplace_radixxx::sort(v.begin(), v.end(), get_region_timestamp());
+        EXPECT_TRUE(is_sorted_(v.begin(), v.end(), region_timestamp_radix()));
+        n = 10*n + 1;
+    }
+}
+
+#if __GXX_EXPERIMENTAL_CXX0X__
+enum class signed_enum : int { low = -1000, high = 1000 };
+enum unsigned_enum : unsigned char { zero, one, two, three };
+
+template <typename T>
+struct EnumTest : ::testing::Test {};
+
+typedef ::testing::Types<std::vector<signed_enum>, std::deque<signed_enum>,
+                         std::vector<unsigned_enum>, std::deque<unsigned_enum> >
+    EnumTestContainers;
+TYPED_TEST_CASE(EnumTest, EnumTestContainers);
+
+TYPED_TEST(EnumTest, EnumTest)
+{
+    typedef TypeParam Container;
+    typedef typename Container::value_type ValueType;
+    typedef typename std::underlying_type<ValueType>::type UnderlyingType;
+
+    int n = 0;
+    Container c;
+    for (int i = 0; i < 7; ++i) {
+        c.resize(n);
+        for (int j = 0; j < n; ++j) {
+            if (UnderlyingType(-1) < 0 && rand()%2)
+                c[j] = ValueType(-rand());
+            else
+                c[j] = ValueType(UnderlyingType(rand()));
+        }
+        inplace_radixxx::sort(c.begin(), c.end());
+        EXPECT_TRUE(is_sorted_(c.begin(), c.end()));
+        n = 10*n + 1;
+    }
+}
+
+TEST(ChronoTest, Duration)
+{
+    int n = 0;
+    std::vector<std::chrono::nanoseconds> v;
+    for (int i = 0; i < 7; ++i) {
+        v.resize(n);
+        for (int j = 0; j < n; ++j)
+            if (rand()%2)
+                v[j] = std::chrono::nanoseconds(rand());
+            else
+                v[j] = std::chrono::nanoseconds(-rand());
+        inplace_radixxx::sort(v.begin(), v.end());
+        EXPECT_TRUE(is_sorted_(v.begin(), v.end()));
+        n = 10*n + 1;
+    }
+}
+
+TEST(ChronoTest, TimePoint)
+{
+    typedef std::chrono::system_clock::time_point time_point;
+
+    int n = 0;
+    std::vector<std::pair<time_point, int> > v;
+    time_point const now = std::chrono::system_clock::now();
+    for (int i = 0; i < 7; ++i) {
+        v.resize(n);
+        for (int j = 0; j < n; ++j)
+            if (rand()%2)
+                v[j].first = now + std::chrono::microseconds(rand());
+            else
+                v[j].first = now - std::chrono::microseconds(rand());
+        inplace_radixxx::sort(v.begin(), v.end(), &std::pair<time_point, int>::first);
+        EXPECT_TRUE(is_sorted_(v.begin(), v.end(), get_first()));
+        n = 10*n + 1;
+    }
+}
+#endif // #if __GXX_EXPERIMENTAL_CXX0X__
+
+TEST(LazySortedRangeTest, Prefix)
+{
+    std::vector<int> v(1024 * 1024);
+    for (std::size_t i = 0; i < v.size(); ++i)
+        if (rand()%2)
+            v[i] = rand();
+        else
+            v[i] = -rand();
+    std::vector<int> expected = v;
+    std::sort(expected.begin(), expected.end());
+
+    typedef inplace_radixxx::lazy_sorted_range<std::vector<int>::iterator> range_t;
+    range_t r(v.begin(), v.end());
+    range_t::iterator it = r.begin();
+    for (std::size_t i = 0; i < 1000; ++i, ++it)
+        ASSERT_EQ(expected[i], *it);
+    EXPECT_TRUE(is_sorted_(v.begin(), it.base()));
+    EXPECT_FALSE(is_sorted_(v.begin(), v.end()));
+}
+
+TEST(LazySortedRangeTest, WithFunctor)
+{
+    int n = 0;
+    std::deque<std::pair<unsigned, int> > d;
+    for (int i = 0; i < 7; ++i) {
+        d.resize(n);
+        for (int j = 0; j < n; ++j)
+            d[j].first = rand();
+        typedef std::deque<std::pair<unsigned, int> >::iterator iterator;
+        typedef inplace_radixxx::lazy_sorted_range<iterator, unsigned std::pair<unsigned, int>::*>
+            range_t;
+        range_t r(d.begin(), d.end(), &std::pair<unsigned, int>::first);
+        std::size_t count = 0;
+        for (range_t::iterator it = r.begin(); it != r.end(); ++it)
+            ++count;
+        EXPECT_EQ(d.size(), count);
+        EXPECT_TRUE(is_sorted_(d.begin(), d.end(), get_first()));
+        n = 10*n + 1;
+    }
+}
+
+#if __GXX_EXPERIMENTAL_CXX0X__
+// Identity key that counts how often it is called outside the main thread.
+struct off_thread_key {
+    template <typename>
+    struct result;
+
+    template <typename Functor, typename T>
+    struct result<Functor (T)> {
+        typedef T type;
+    };
+
+    template <typename T>
+    T const& operator()(T const& x) const {
+        if (std::this_thread::get_id() != main_thread)
+            ++calls;
+        return x;
+    }
+
+    static std::thread::id main_thread;
+    static std::atomic<long> calls;
+};
+
+std::thread::id off_thread_key::main_thread = std::this_thread::get_id();
+std::atomic<long> off_thread_key::calls(0);
+
+template <typename T>
+struct LazySortedRangePrefetchTest : ::testing::Test {};
+
+typedef ::testing::Types<std::vector<long>, std::deque<unsigned> >
+    LazySortedRangePrefetchTestContainers;
+TYPED_TEST_CASE(LazySortedRangePrefetchTest, LazySortedRangePrefetchTestContainers);
+
+TYPED_TEST(LazySortedRangePrefetchTest, LazySortedRangePrefetchTest)
+{
+    typedef TypeParam Container;
+    typedef typename Container::iterator Iterator;
+    typedef inplace_radixxx::lazy_sorted_range<Iterator, off_thread_key> range_t;
+
+    int n = 0;
+    Container c;
+    for (int i = 0; i < 7; ++i) {
+        c.resize(n);
+        for (int j = 0; j < n; ++j)
+            c[j] = rand() - RAND_MAX / 2;
+        for (int prefetch = 0; prefetch < 2; ++prefetch) {
+            std::random_shuffle(c.begin(), c.end());
+            off_thread_key::calls = 0;
+            range_t r(c.begin(), c.end(), off_thread_key());
+            r.prefetch(prefetch);
+            Container sorted(r.begin(), r.end());
+            EXPECT_TRUE(is_sorted_(sorted.begin(), sorted.end()));
+            EXPECT_TRUE(is_sorted_(c.begin(), c.end()));
+            // Buckets after the first one were sorted by the prefetch thread.
+            if (!prefetch) {
+                EXPECT_EQ(0, off_thread_key::calls.load());
+            } else if (n > 10000) {
+                EXPECT_LT(0, off_thread_key::calls.load());
+            }
+        }
+        n = 10*n + 1;
+    }
+}
+#endif // #if __GXX_EXPERIMENTAL_CXX0X__
+
+template <typename T>
+struct SortAndIndexTest : ::testing::Test {};
+
+typedef ::testing::Types<std::vector<int>, std::deque<unsigned>,
+                         std::vector<short>, std::vector<unsigned long>,
+                         std::vector<bool>, std::vector<double> >
+    SortAndIndexTestContainers;
+TYPED_TEST_CASE(SortAndIndexTest, SortAndIndexTestContainers);
+
+TYPED_TEST(SortAndIndexTest, SortAndIndexTest)
+{
+    typedef TypeParam Container;
+    typedef typename Container::value_type ValueType;
+    typedef typename Container::iterator Iterator;
+
+    int n = 0;
+    Container c;
+    for (int i = 0; i < 6; ++i) {
+        c.resize(n);
+        for (int j = 0; j < n; ++j) {
+            if (ValueType(-1) < 0 && rand()%2)
+                c[j] = -(rand() % 1000);
+            else
+                c[j] = rand() % 1000;
+        }
+        for (std::size_t levels = 1; levels <= 2; ++levels) {
+            inplace_radixxx::radix_index<Iterator, get_self> index =
+                inplace_radixxx::sort_and_index(c.begin(), c.end(), get_self(), levels);
+            EXPECT_TRUE(is_sorted_(c.begin(), c.end()));
+            bool found = true;
+            for (int j = 0; j < 100; ++j) {
+                ValueType const key = ValueType(rand() % 2200 - 1100);
+                found = found && index.equal_range(key) == std::equal_range(c.begin(), c.end(), key);
+            }
+            EXPECT_TRUE(found);
+        }
+        n = 10*n + 1;
+    }
+}
+
+TEST(RadixIndexTest, Levels)
+{
+    std::vector<unsigned> v(10);
+    for (std::size_t j = 0; j < v.size(); ++j)
+        v[j] = rand();
+    inplace_radixxx::radix_index<std::vector<unsigned>::iterator, get_self> index =
+        inplace_radixxx::sort_and_index(v.begin(), v.end(), get_self(), 3);
+    EXPECT_TRUE(is_sorted_(v.begin(), v.end()));
+    EXPECT_EQ(65536u, index.bucket_count());
+    for (std::size_t j = 0; j < v.size(); ++j)
+        EXPECT_EQ(v[j], *index.lower_bound(v[j]));
+}
+
+TEST(RadixIndexTest, KeyTraits)
+{
+    typedef std::vector<std::pair<region_timestamp, int> > Container;
+
+    Container v(100000);
+    for (std::size_t j = 0; j < v.size(); ++j) {
+        v[j].first.region = rand() % 4;
+        v[j].first.timestamp = rand() % 1000;
+    }
+    inplace_radixxx::radix_index<Container::iterator, get_region_timestamp> index =
+        inplace_radixxx::sort_and_index(v.begin(), v.end(), get_region_timestamp(), 2);
+    EXPECT_TRUE(is_sorted_(v.begin(), v.end(), region_timestamp_radix()));
+    for (unsigned short region = 0; region < 5; ++region) {
+        region_timestamp const key = { region, 500 };
+        std::size_t expected = 0;
+        for (std::size_t j = 0; j < v.size(); ++j)
+            expected += v[j].first.region == region && v[j].first.timestamp == 500;
+        std::pair<Container::iterator, Container::iterator> r = index.equal_range(key);
+        EXPECT_EQ(expected, std::size_t(r.second - r.first));
+    }
+}
+
+template <typename T>
+struct SortAppendTest : ::testing::Test {};
+
+typedef ::testing::Types<std::vector<std::pair<int, int> >,
+                         std::deque<std::pair<unsigned, int> >,
+                         std::vector<std::pair<short, int> >,
+                         std::vector<std::pair<unsigned long, int> >,
+                         std::deque<std::pair<double, int> > >
+    SortAppendTestContainers;
+TYPED_TEST_CASE(SortAppendTest, SortAppendTestContainers);
+
+TYPED_TEST(SortAppendTest, SortAppendTest)
+{
+    typedef TypeParam Container;
+    typedef typename Container::value_type ValueType;
+    typedef typename ValueType::first_type KeyType;
+
+    int n = 1;
+    for (int i = 0; i < 6; ++i) {
+        for (int tail = 0; tail <= n; tail += n / 3 + 1) {
+            // Prefix elements have second == 0 and must stay in front of
+            // appended ones with equal keys.
+            Container c(n + tail);
+            for (int j = 0; j < n + tail; ++j) {
+                if (KeyType(-1) < 0 && rand()%2)
+                    c[j].first = -rand();
+                else
+                    c[j].first = rand() % (j < n ? RAND_MAX : n + 1);
+                c[j].second = j >= n;
+            }
+            inplace_radixxx::sort(c.begin(), c.begin() + n, get_first());
+            Container expected = c;
+            std::sort(expected.begin(), expected.end());
+
+            Container d = c;
+            inplace_radixxx::sort_append(c.begin(), c.begin() + n, c.end(), get_first());
+            EXPECT_TRUE(c == expected);
+
+            std::vector<ValueType> buffer(tail);
+            inplace_radixxx::sort_append(d.begin(), d.begin() + n, d.end(), get_first(),
+                                         buffer.begin());
+            EXPECT_TRUE(d == expected);
+        }
+        n *= 10;
+    }
+}
+
+TEST(SortAppendTest, NoFunctor)
+{
+    std::vector<int> v(1024 * 1024);
+    for (std::size_t i = 0; i < v.size(); ++i)
+        if (rand()%2)
+            v[i] = rand();
+        else
+            v[i] = -rand();
+    std::vector<int>::iterator middle = v.begin() + v.size() / 4 * 3;
+    inplace_radixxx::sort(v.begin(), middle);
+    inplace_radixxx::sort_append(v.begin(), middle, v.end());
+    EXPECT_TRUE(is_sorted_(v.begin(), v.end()));
+}
+
+template <typename T>
+struct ResumableSortTest : ::testing::Test {};
+
+typedef ::testing::Types<std::vector<unsigned>, std::deque<int>,
+                         std::vector<short>, std::deque<unsigned long>,
+                         std::deque<bool> >
+    ResumableSortTestContainers;
+TYPED_TEST_CASE(ResumableSortTest, ResumableSortTestContainers);
+
+TYPED_TEST(ResumableSortTest, ResumableSortTest)
+{
+    typedef TypeParam Container;
+    typedef typename Container::value_type ValueType;
+    typedef typename Container::iterator Iterator;
+
+    int n = 0;
+    Container c;
+    for (int i = 0; i < 7; ++i) {
+        c.resize(n);
+        for (int j = 0; j < n; ++j) {
+            if (ValueType(-1) < 0 && rand()%2)
+                c[j] = -rand();
+            else
+                c[j] = rand();
+        }
+        Container expected = c;
+        std::sort(expected.begin(), expected.end());
+
+        inplace_radixxx::resumable_sort<Iterator> s(c.begin(), c.end());
+        std::size_t slices = 1;
+        while (!s.step(1000))
+            ++slices;
+        EXPECT_TRUE(s.done());
+        EXPECT_FALSE(s.cancelled());
+        EXPECT_TRUE(c == expected);
+        EXPECT_LE(std::size_t(n) / 1000, slices);
+        n = 10*n + 1;
+    }
+}
+
+TEST(ResumableSortTest, Cancel)
+{
+    std::vector<std::pair<int, int> > v(1024 * 1024);
+    for (std::size_t i = 0; i < v.size(); ++i)
+        v[i].first = rand() - RAND_MAX / 2;
+    std::vector<std::pair<int, int> > expected = v;
+    std::sort(expected.begin(), expected.end());
+
+    typedef inplace_radixxx::resumable_sort<std::vector<std::pair<int, int> >::iterator,
+                                            int std::pair<int, int>::*> sort_t;
+    sort_t s(v.begin(), v.end(), &std::pair<int, int>::first);
+    EXPECT_FALSE(s.step(v.size() * 3 / 2));
+    s.cancel();
+    EXPECT_TRUE(s.step(1));
+    EXPECT_TRUE(s.cancelled());
+    std::sort(v.begin(), v.end());
+    EXPECT_TRUE(v == expected);
+}
+
+template <typename T>
+struct ShardPartitionerNarrowRangeTest : ::testing::Test {};
+
+typedef ::testing::Types<int, long
+#if __GXX_EXPERIMENTAL_CXX0X__
+                         , std::chrono::microseconds
+#endif
+                         > ShardPartitionerNarrowRangeTestKeys;
+TYPED_TEST_CASE(ShardPartitionerNarrowRangeTest, ShardPartitionerNarrowRangeTestKeys);
+
+// Keys within +-2^30 share the top digits of a 64-bit key, so the buckets
+// only split them after focusing on their range.
+TYPED_TEST(ShardPartitionerNarrowRangeTest, ShardPartitionerNarrowRangeTest)
+{
+    typedef TypeParam KeyType;
+    typedef typename std::vector<KeyType>::iterator Iterator;
+    typedef inplace_radixxx::shard_partitioner<Iterator> partitioner_t;
+    typedef typename partitioner_t::radix_type radix_type;
+    std::size_t const nshards = 4, shard_size = 50000, n = nshards * shard_size;
+
+    std::vector<std::vector<KeyType> > shards(nshards, std::vector<KeyType>(shard_size));
+    for (std::size_t p = 0; p < nshards; ++p)
+        for (std::size_t j = 0; j < shard_size; ++j)
+            shards[p][j] = KeyType(long(rand() % (1 << 30)) * (rand() % 2 ? 1 : -1));
+
+    partitioner_t partitioner(3);
+    ASSERT_EQ(65536u, partitioner.histogram_size());
+    radix_type range[2] = { 0, 0 };
+    for (std::size_t p = 0; p < nshards; ++p) {
+        radix_type shard_range[2] = { 0, 0 };
+        partitioner.key_range(shards[p].begin(), shards[p].end(), shard_range);
+        range[0] = std::max(range[0], shard_range[0]);
+        range[1] = std::max(range[1], shard_range[1]);
+    }
+    partitioner.focus(range);
+    std::vector<std::size_t> counts(partitioner.histogram_size());
+    for (std::size_t p = 0; p < nshards; ++p)
+        partitioner.histogram(shards[p].begin(), shards[p].end(), &counts[0]);
+    std::size_t splitters[nshards - 1];
+    partitioner.choose_splitters(&counts[0], nshards, splitters);
+
+    std::vector<std::vector<KeyType> > parts(nshards);
+    for (std::size_t p = 0; p < nshards; ++p) {
+        Iterator bounds[nshards + 1];
+        partitioner.partition(shards[p].begin(), shards[p].end(), splitters, nshards, bounds);
+        for (std::size_t q = 0; q < nshards; ++q)
+            parts[q].insert(parts[q].end(), bounds[q], bounds[q + 1]);
+    }
+    for (std::size_t q = 0; q < nshards; ++q) {
+        EXPECT_NEAR(n / nshards, parts[q].size(), n / nshards / 20);
+        if (q > 0 && !parts[q - 1].empty() && !parts[q].empty()) {
+            EXPECT_TRUE(*std::max_element(parts[q - 1].begin(), parts[q - 1].end())
+                        < *std::min_element(parts[q].begin(), parts[q].end()));
+        }
+    }
+}
+
+#if __unix__
+template <typename Function>
+bool run_workers(int nworkers, Function f)
+{
+    std::vector<pid_t> pids(nworkers);
+    for (int p = 0; p < nworkers; ++p) {
+        pids[p] = fork();
+        if (pids[p] == 0) {
+            f(p);
+            _exit(0);
+        }
+    }
+    bool ok = true;
+    for (int p = 0; p < nworkers; ++p) {
+        int status = 0;
+        ok = waitpid(pids[p], &status, 0) == pids[p] && WIFEXITED(status)
+             && WEXITSTATUS(status) == 0 && ok;
+    }
+    return ok;
+}
+
+struct shared_shards {
+    static int const nshards = 4;
+    static int const shard_size = 250000;
+    static std::size_t const levels = 2;
+
+    typedef int* iterator;
+    typedef inplace_radixxx::shard_partitioner<iterator> partitioner;
+
+    int input[nshards][shard_size];
+    int output[nshards * shard_size];
+    std::size_t histograms[nshards][2 << 16];
+    std::size_t splitters[nshards - 1];
+    std::size_t bounds[nshards][nshards + 1];
+};
+
+struct histogram_worker {
+    explicit histogram_worker(shared_shards* s) : s_(s) {}
+
+    void operator()(int p) const {
+        shared_shards::partitioner partitioner(shared_shards::levels);
+        partitioner.histogram(s_->input[p], s_->input[p] + shared_shards::shard_size,
+                              s_->histograms[p]);
+    }
+
+    shared_shards* s_;
+};
+
+struct partition_worker {
+    explicit partition_worker(shared_shards* s) : s_(s) {}
+
+    void operator()(int p) const {
+        shared_shards::partitioner partitioner(shared_shards::levels);
+        int* bounds[shared_shards::nshards + 1];
+        partitioner.partition(s_->input[p], s_->input[p] + shared_shards::shard_size,
+                              s_->splitters, shared_shards::nshards, bounds);
+        for (int i = 0; i <= shared_shards::nshards; ++i)
+            s_->bounds[p][i] = bounds[i] - s_->input[p];
+    }
+
+    shared_shards* s_;
+};
+
+struct sort_worker {
+    explicit sort_worker(shared_shards* s) : s_(s) {}
+
+    void operator()(int p) const {
+        std::size_t offset = 0;
+        for (int q = 0; q < p; ++q)
+            for (int shard = 0; shard < shared_shards::nshards; ++shard)
+                offset += s_->bounds[shard][q + 1] - s_->bounds[shard][q];
+        int* out = s_->output + offset;
+        for (int shard = 0; shard < shared_shards::nshards; ++shard)
+            out = std::copy(s_->input[shard] + s_->bounds[shard][p],
+                            s_->input[shard] + s_->bounds[shard][p + 1], out);
+        inplace_radixxx::sort(s_->output + offset, out);
+    }
+
+    shared_shards* s_;
+};
+
+TEST(ShardPartitionerTest, MultiProcess)
+{
+    typedef shared_shards::partitioner partitioner_t;
+    int const nshards = shared_shards::nshards;
+    int const n = nshards * shared_shards::shard_size;
+
+    void* m = mmap(0, sizeof(shared_shards), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(MAP_FAILED, m);
+    shared_shards* s = static_cast<shared_shards*>(m);
+    std::fill_n(&s->histograms[0][0], nshards * (2 << 16), std::size_t(0));
+
+    // Half of the keys crowd into a range covered by a single top digit.
+    for (int p = 0; p < nshards; ++p)
+        for (int j = 0; j < shared_shards::shard_size; ++j)
+            if (rand()%2)
+                s->input[p][j] = rand() % (1 << 24);
+            else
+                s->input[p][j] = rand() % 2 ? rand() : -rand();
+    std::vector<int> expected(&s->input[0][0], &s->input[0][0] + n);
+    std::sort(expected.begin(), expected.end());
+
+    partitioner_t partitioner(shared_shards::levels);
+    ASSERT_GE(sizeof(s->histograms[0]) / sizeof(std::size_t), partitioner.histogram_size());
+    ASSERT_TRUE(run_workers(nshards, histogram_worker(s)));
+    for (int p = 1; p < nshards; ++p)
+        for (std::size_t i = 0; i < partitioner.histogram_size(); ++i)
+            s->histograms[0][i] += s->histograms[p][i];
+    partitioner.choose_splitters(s->histograms[0], nshards, s->splitters);
+    ASSERT_TRUE(run_workers(nshards, partition_worker(s)));
+    ASSERT_TRUE(run_workers(nshards, sort_worker(s)));
+
+    EXPECT_TRUE(std::equal(expected.begin(), expected.end(), s->output));
+    for (int p = 0; p < nshards; ++p) {
+        std::size_t size = 0;
+        for (int shard = 0; shard < nshards; ++shard)
+            size += s->bounds[shard][p + 1] - s->bounds[shard][p];
+        EXPECT_NEAR(n / nshards, size, n / nshards / 20);
+    }
+    munmap(m, sizeof(shared_shards));
+}
+#endif // #if __unix__
+
+#if __GXX_EXPERIMENTAL_CXX0X__
+template <typename T>
+struct SortZipTest : ::testing::Test {};
+
+typedef ::testing::Types<unsigned char, short, unsigned, int, unsigned long, long,
+                         bool, signed_enum, std::chrono::nanoseconds, double>
+    SortZipTestKeys;
+TYPED_TEST_CASE(SortZipTest, SortZipTestKeys);
+
+TYPED_TEST(SortZipTest, SortZipTest)
+{
+    typedef TypeParam KeyType;
+
+    int n = 0;
+    std::vector<KeyType> keys, original;
+    std::vector<int> indices;
+    std::deque<std::string> names;
+    for (int i = 0; i < 7; ++i) {
+        keys.resize(n), indices.resize(n), names.resize(n);
+        for (int j = 0; j < n; ++j) {
+            if (rand()%2)
+                keys[j] = KeyType(rand());
+            else
+                keys[j] = KeyType(-rand());
+            indices[j] = j;
+            names[j] = std::to_string(j);
+        }
+        original = keys;
+        inplace_radixxx::sort_zip(keys.begin(), keys.end(), indices.begin(), names.begin());
+        EXPECT_TRUE(is_sorted_(keys.begin(), keys.end()));
+        bool lockstep = true;
+        for (int j = 0; j < n; ++j)
+            lockstep = lockstep && keys[j] == original[indices[j]]
+                                && names[j] == std::to_string(indices[j]);
+        EXPECT_TRUE(lockstep);
+        n = 10*n + 1;
+    }
+}
+
+TEST(SortZipTest, KeyTraits)
+{
+    typedef inplace_radixxx::key_traits<region_timestamp> traits;
+
+    int n = 0;
+    std::vector<region_timestamp> keys;
+    std::vector<int> indices;
+    for (int i = 0; i < 7; ++i) {
+        keys.resize(n), indices.resize(n);
+        for (int j = 0; j < n; ++j) {
+            keys[j].region = rand() % 16;
+            keys[j].timestamp = rand();
+            indices[j] = j;
+        }
+        std::vector<region_timestamp> const original = keys;
+        inplace_radixxx::sort_zip(keys.begin(), keys.end(), indices.begin());
+        bool sorted = true, lockstep = true;
+        for (int j = 0; j < n; ++j) {
+            unsigned long const radix = traits::to_radix(keys[j]);
+            sorted = sorted && (j == 0 || traits::to_radix(keys[j-1]) <= radix);
+            lockstep = lockstep && radix == traits::to_radix(original[indices[j]]);
+        }
+        EXPECT_TRUE(sorted);
+        EXPECT_TRUE(lockstep);
+        n = 10*n + 1;
+    }
+}
+#endif // #if __GXX_EXPERIMENTAL_CXX0X__
+
 TEST(ReverseSortTest, NoFunctor)
 {
     std::vector<int> v(1024 * 1024);